@@ -22,6 +22,9 @@ namespace ast {
 
   class Node {
   public:
+    // set by the interner on closed subtrees that occur more than once
+    bool memoize = false;
+
     virtual NodeType type() = 0;
     virtual string to_string() = 0;
   };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+using namespace std;
+
+namespace channel {
+  // a fixed capacity channel between two pipeline stages, push blocks while it is full
+  template<typename T>
+  class BoundedQueue {
+  public:
+    BoundedQueue(size_t capacity)
+      : capacity(capacity), closed(false) {};
+
+    auto push(T item) -> void {
+      unique_lock<mutex> lock(this->lock);
+      this->not_full.wait(lock, [&]() {
+          return this->items.size() < this->capacity;
+        });
+      this->items.push_back(std::move(item));
+      this->not_empty.notify_one();
+    }
+
+    // blocks until an item is available, returns false once the queue is closed and drained
+    auto pop(T &item) -> bool {
+      unique_lock<mutex> lock(this->lock);
+      this->not_empty.wait(lock, [&]() {
+          return !this->items.empty() || this->closed;
+        });
+      if (this->items.empty()) {
+        return false;
+      }
+      item = std::move(this->items.front());
+      this->items.pop_front();
+      this->not_full.notify_one();
+      return true;
+    }
+
+    // like pop, but gives up and returns false once timeout passed without an item
+    template<typename Duration>
+    auto pop_for(T &item, Duration timeout) -> bool {
+      unique_lock<mutex> lock(this->lock);
+      auto ready = this->not_empty.wait_for(lock, timeout, [&]() {
+          return !this->items.empty() || this->closed;
+        });
+      if (!ready || this->items.empty()) {
+        return false;
+      }
+      item = std::move(this->items.front());
+      this->items.pop_front();
+      this->not_full.notify_one();
+      return true;
+    }
+
+    auto close() -> void {
+      unique_lock<mutex> lock(this->lock);
+      this->closed = true;
+      this->not_empty.notify_all();
+    }
+
+  private:
+    size_t capacity;
+    bool closed;
+    deque<T> items;
+    mutex lock;
+    condition_variable not_full;
+    condition_variable not_empty;
+  };
+}
@@ -5,7 +5,9 @@
 #include <regex>
 #include <string>
 #include <vector>
+#include <chrono>
 #include <memory>
+#include <stdexcept>
 #include <functional>
 #include <range/v3/all.hpp>
 #ifndef FORMAT_HEADER
@@ -15,12 +17,14 @@
 #endif
 #include "ast.hpp"
 #include "type.hpp"
+#include "interner.hpp"
 
 using namespace std;
 using namespace ast;
 using namespace fmt;
 using namespace type;
 using namespace ranges;
+using namespace interner;
 
 namespace checker {
   typedef map<string, shared_ptr<Type>> environment;
@@ -28,6 +32,148 @@ namespace checker {
   typedef set<shared_ptr<Type>> typevars;
   regex digits_regex("^(\\d+)$");
 
+  // the builtins every example and test is checked against
+  auto default_env() -> environment {
+    auto var1 = make_shared<TypeVariable>();
+    auto var2 = make_shared<TypeVariable>();
+    auto var3 = make_shared<TypeVariable>();
+
+    auto pair_type = make_shared<TypeOperator>("*", vector<shared_ptr<Type>>({ var1, var2 }));
+    return {
+      { "true", BooleanType },
+      { "pair", FunctionType(var1, FunctionType(var2, pair_type)) },
+      { "cond", FunctionType(BooleanType, FunctionType(var3, FunctionType(var3, var3))) },
+      { "pred", FunctionType(IntegerType, IntegerType) },
+      { "zero?", FunctionType(IntegerType, BooleanType) },
+      { "times", FunctionType(IntegerType, FunctionType(IntegerType, IntegerType)) }
+    };
+  }
+
+  // resources a single check may consume, 0 means unlimited
+  struct Limits {
+    size_t max_type_size = 0;
+    size_t max_unify_steps = 0;
+    size_t max_type_memory = 0;
+    chrono::milliseconds timeout = chrono::milliseconds::zero();
+  };
+
+  enum class Resource : size_t {
+    NONE,
+    TYPE_SIZE,
+    UNIFY_STEPS,
+    TYPE_MEMORY,
+    DEADLINE
+  };
+
+  auto resource_name(Resource r) -> string {
+    switch (r) {
+    case Resource::NONE:
+      return "none";
+    case Resource::TYPE_SIZE:
+      return "type size";
+    case Resource::UNIFY_STEPS:
+      return "unify steps";
+    case Resource::TYPE_MEMORY:
+      return "type memory";
+    case Resource::DEADLINE:
+      return "deadline";
+    default:
+      return "unknown";
+    }
+  }
+
+  class BudgetExceeded : public runtime_error {
+  public:
+    Resource resource;
+
+    BudgetExceeded(Resource r)
+      : runtime_error(format("Budget exceeded: {}", resource_name(r))), resource(r) {};
+  };
+
+  struct Budget {
+    Limits limits;
+    size_t unify_steps = 0;
+    size_t type_memory = 0;
+    size_t ticks = 0;
+    chrono::steady_clock::time_point deadline;
+  };
+
+  // the budget of the check in progress on this thread, unlimited outside of `check`
+  thread_local Budget budget;
+
+  // reading the clock is not free, so only look at it every 1024 ticks
+  inline auto tick() -> void {
+    if (budget.limits.timeout != chrono::milliseconds::zero() &&
+        (++budget.ticks & 1023) == 0 &&
+        chrono::steady_clock::now() > budget.deadline) {
+      throw BudgetExceeded(Resource::DEADLINE);
+    }
+  }
+
+  inline auto charge_unify_step() -> void {
+    tick();
+    if (++budget.unify_steps > budget.limits.max_unify_steps &&
+        budget.limits.max_unify_steps != 0) {
+      throw BudgetExceeded(Resource::UNIFY_STEPS);
+    }
+  }
+
+  inline auto charge_type_memory(size_t bytes) -> void {
+    if (budget.limits.max_type_memory != 0) {
+      budget.type_memory += bytes;
+      if (budget.type_memory > budget.limits.max_type_memory) {
+        throw BudgetExceeded(Resource::TYPE_MEMORY);
+      }
+    }
+  }
+
+  auto new_variable() -> shared_ptr<Type> {
+    charge_type_memory(sizeof(TypeVariable));
+    return make_shared<TypeVariable>();
+  }
+
+  auto new_operator(string name, vector<shared_ptr<Type>> types) -> shared_ptr<Type> {
+    charge_type_memory(sizeof(TypeOperator) + name.size() + types.size() * sizeof(shared_ptr<Type>));
+    return make_shared<TypeOperator>(name, types);
+  }
+
+  auto new_function(shared_ptr<Type> from_type, shared_ptr<Type> to_type) -> shared_ptr<Type> {
+    return new_operator("->", vector<shared_ptr<Type>>({ from_type, to_type }));
+  }
+
+  // number of nodes in the tree spelled out by t, counting stops once it passes limit
+  auto type_size(shared_ptr<Type> t, size_t limit) -> size_t {
+    size_t size = 0;
+    vector<shared_ptr<Type>> stack = { t };
+    while (!stack.empty() && size <= limit) {
+      tick();
+      auto top = stack.back();
+      stack.pop_back();
+      size += 1;
+      while (top->type() == TypeType::VARIABLE && static_pointer_cast<TypeVariable>(top)->instance != nullptr) {
+        top = static_pointer_cast<TypeVariable>(top)->instance;
+      }
+      if (top->type() == TypeType::OPERATOR) {
+        auto &types = static_pointer_cast<TypeOperator>(top)->types;
+        stack.insert(stack.end(), types.begin(), types.end());
+      }
+    }
+    return size;
+  }
+
+  auto check_type_size(shared_ptr<Type> t) -> void {
+    auto limit = budget.limits.max_type_size;
+    if (limit != 0 && type_size(t, limit) > limit) {
+      throw BudgetExceeded(Resource::TYPE_SIZE);
+    }
+  }
+
+  // to_string is linear in the size of the tree, never render more than the budget allows
+  auto show(shared_ptr<Type> t) -> string {
+    check_type_size(t);
+    return t->to_string();
+  }
+
   template<typename Base, typename T>
   inline bool instanceof(const shared_ptr<T> ptr) {
     return dynamic_pointer_cast<Base>(ptr) != nullptr;
@@ -60,8 +206,10 @@ namespace checker {
   }
 
   auto occurs_in_type(shared_ptr<Type> var, shared_ptr<Type> t) -> bool {
+    charge_unify_step();
     auto pruned = prune(t);
-    if (var == pruned) {
+    // ids wrap around, so only the same object is the same variable
+    if (var.get() == pruned.get()) {
       return true;
     } else if (pruned->type() == TypeType::OPERATOR) {
       return occurs_in(var, static_pointer_cast<TypeOperator>(pruned)->types);
@@ -78,14 +226,19 @@ namespace checker {
 
   auto fresh(shared_ptr<Type> t, typevars non_generic) -> shared_ptr<Type> {
     typevar_mapping mapping = {};
+    size_t size = 0;
 
     function<shared_ptr<Type>(shared_ptr<Type>)> fresh_rec = [&](shared_ptr<Type> tp) -> shared_ptr<Type> {
+      tick();
+      if (budget.limits.max_type_size != 0 && ++size > budget.limits.max_type_size) {
+        throw BudgetExceeded(Resource::TYPE_SIZE);
+      }
       auto pruned = prune(tp);
       if (pruned->type() == TypeType::VARIABLE) {
         if (is_generic(pruned, non_generic)) {
           auto result = mapping.find(pruned);
           if (result == mapping.end()) {
-            mapping[pruned] = make_shared<TypeVariable>();
+            mapping[pruned] = new_variable();
           }
           return mapping[pruned];
         } else {
@@ -96,7 +249,7 @@ namespace checker {
         auto freshs = oper->types | view::transform([&](shared_ptr<Type> ta) {
             return fresh_rec(ta);
           });
-        return make_shared<TypeOperator>(oper->name, freshs);
+        return new_operator(oper->name, freshs);
       } else {
         return nullptr;
       }
@@ -117,11 +270,12 @@ namespace checker {
   }
 
   auto unify(shared_ptr<Type> t1, shared_ptr<Type> t2) -> void {
+    charge_unify_step();
     auto pruned1 = prune(t1);
     auto pruned2 = prune(t2);
 
     if (pruned1->type() == TypeType::VARIABLE) {
-      if (pruned1 != pruned2) {
+      if (pruned1.get() != pruned2.get()) {
         if (occurs_in_type(pruned1, pruned2)) {
           throw runtime_error("Recursive unification");
         }
@@ -133,7 +287,7 @@ namespace checker {
       auto oper1 = static_pointer_cast<TypeOperator>(pruned1);
       auto oper2 = static_pointer_cast<TypeOperator>(pruned2);
       if (oper1->name != oper2->name || oper1->types.size() != oper2->types.size()) {
-        throw runtime_error(format("Type mismatch: {0} != {1}", pruned1->to_string(), pruned2->to_string()));
+        throw runtime_error(format("Type mismatch: {0} != {1}", show(pruned1), show(pruned2)));
       }
       auto types1 = oper1->types;
       auto types2 = oper2->types;
@@ -143,11 +297,27 @@ namespace checker {
         unify(*entry1, *entry2);
       }
     } else {
-      throw runtime_error(format("Can not unify: {0}, {1}", pruned1->to_string(), pruned2->to_string()));
+      throw runtime_error(format("Can not unify: {0}, {1}", show(pruned1), show(pruned2)));
     }
   }
 
-  auto analyse(shared_ptr<Node> node, environment env, typevars non_generic) -> shared_ptr<Type> {
+  // generalized types of the memoizable subtrees analysed so far in this thread's check
+  thread_local map<Node*, shared_ptr<Type>> memo;
+
+  // empties the memo when a top level analyse ends, whether it returns or throws
+  struct MemoScope {
+    MemoScope() {
+      memo.clear();
+    }
+
+    ~MemoScope() {
+      memo.clear();
+    }
+  };
+
+  auto analyse(shared_ptr<Node> node, environment env, typevars non_generic) -> shared_ptr<Type>;
+
+  auto infer(shared_ptr<Node> node, environment env, typevars non_generic) -> shared_ptr<Type> {
     switch (node->type()) {
     case NodeType::IDENTIFIER:
       return get_type(static_pointer_cast<Identifier>(node)->name, env, non_generic);
@@ -155,19 +325,19 @@ namespace checker {
       auto func_node = static_pointer_cast<Apply>(node);
       auto func_type = analyse(func_node->func, env, non_generic);
       auto arg_type = analyse(func_node->arg, env, non_generic);
-      auto return_type = make_shared<TypeVariable>();
-      unify(FunctionType(arg_type, return_type), func_type);
+      auto return_type = new_variable();
+      unify(new_function(arg_type, return_type), func_type);
       return return_type;
     }
     case NodeType::LAMBDA: {
       auto lambda_node = static_pointer_cast<Lambda>(node);
-      auto param_type = make_shared<TypeVariable>();
+      auto param_type = new_variable();
       environment new_env = env;
       typevars new_non_generic = non_generic;
       new_env[lambda_node->param] = param_type;
       new_non_generic.insert(param_type);
       auto return_type = analyse(lambda_node->body, new_env, new_non_generic);
-      return FunctionType(param_type, return_type);
+      return new_function(param_type, return_type);
     }
     case NodeType::LET: {
       auto let_node = static_pointer_cast<Let>(node);
@@ -178,7 +348,7 @@ namespace checker {
     }
     case NodeType::LETREC: {
       auto letrec_node = static_pointer_cast<Letrec>(node);
-      auto new_type = make_shared<TypeVariable>();
+      auto new_type = new_variable();
       environment new_env = env;
       typevars new_non_generic = non_generic;
       new_env[letrec_node->name] = new_type;
@@ -192,7 +362,64 @@ namespace checker {
     }
   }
 
+  // a closed subtree only mentions top level names, so none of the type variables in its type
+  // can be non generic, callers get a fresh instance and the memoized type is never unified
+  auto analyse(shared_ptr<Node> node, environment env, typevars non_generic) -> shared_ptr<Type> {
+    if (!node->memoize) {
+      return infer(node, env, non_generic);
+    }
+    auto result = memo.find(node.get());
+    if (result == memo.end()) {
+      result = memo.insert({ node.get(), infer(node, env, non_generic) }).first;
+    }
+    return fresh(result->second, typevars({}));
+  }
+
   auto analyse(shared_ptr<Node> node, environment env) -> shared_ptr<Type> {
+    MemoScope scope;
     return analyse(node, env, typevars({}));
   }
+
+  enum class CheckStatus : size_t {
+    OK,
+    TYPE_ERROR,
+    BUDGET_EXCEEDED,
+    // never produced by check, for callers that report unparsable input alongside
+    PARSE_ERROR
+  };
+
+  struct CheckResult {
+    CheckStatus status;
+    shared_ptr<Type> type;
+    // the limit that was hit, NONE unless status is BUDGET_EXCEEDED
+    Resource resource;
+    string message;
+    // how much unification the check took, also when it had no limit
+    size_t unify_steps = 0;
+  };
+
+  // analyse under the given limits, a well typed result is guaranteed to fit in max_type_size
+  auto check(shared_ptr<Node> node, environment env, Limits limits) -> CheckResult {
+    auto saved = budget;
+    budget = Budget();
+    // names of the result only depend on this expression, not on what was checked before
+    TypeVariable::next_id = 0;
+    budget.limits = limits;
+    budget.deadline = chrono::steady_clock::now() + limits.timeout;
+
+    CheckResult result;
+    try {
+      auto type = analyse(Interner(tick).intern(node), env);
+      check_type_size(type);
+      result = { CheckStatus::OK, type, Resource::NONE, "" };
+    } catch (BudgetExceeded &e) {
+      result = { CheckStatus::BUDGET_EXCEEDED, nullptr, e.resource, e.what() };
+    } catch (runtime_error &e) {
+      result = { CheckStatus::TYPE_ERROR, nullptr, Resource::NONE, e.what() };
+    }
+
+    result.unify_steps = budget.unify_steps;
+    budget = saved;
+    return result;
+  }
 }
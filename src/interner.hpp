@@ -0,0 +1,158 @@
+#pragma once
+
+#include <tuple>
+#include <unordered_map>
+#include <limits>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include "ast.hpp"
+
+using namespace std;
+using namespace ast;
+
+namespace interner {
+  // kind, name, children and whether the subtree is closed where it occurs
+  typedef tuple<NodeType, string, Node*, Node*, bool> node_key;
+
+  // children are interned before their parent, so hashing their addresses hashes their structure
+  struct node_key_hash {
+    auto operator()(const node_key &key) const -> size_t {
+      size_t seed = hash<size_t>()((size_t)get<0>(key));
+      auto mix = [&](size_t h) {
+        seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+      };
+      mix(hash<string>()(get<1>(key)));
+      mix(hash<Node*>()(get<2>(key)));
+      mix(hash<Node*>()(get<3>(key)));
+      mix(hash<bool>()(get<4>(key)));
+      return seed;
+    }
+  };
+
+  // the reach of a subtree that refers to no enclosing binder
+  const size_t unbound = numeric_limits<size_t>::max();
+
+  // rebuilds an ast so that structurally identical subtrees are the same node,
+  // a subtree is closed when none of its free names is bound by an enclosing binder,
+  // so its type only depends on the top level environment and can be inferred once
+  class Interner {
+  public:
+    // visit is called once per node, it lets the caller bound the time spent here
+    Interner(function<void()> visit = []() {})
+      : visit(visit), level(0) {};
+
+    auto intern(shared_ptr<Node> node) -> shared_ptr<Node> {
+      size_t reach;
+      return intern(node, reach);
+    }
+
+  private:
+    function<void()> visit;
+    unordered_map<node_key, shared_ptr<Node>, node_key_hash> table;
+    // binders in scope for every name, numbered by how many binders enclose them
+    unordered_map<string, vector<size_t>> binders;
+    size_t level;
+
+    // reach is the outermost enclosing binder a subtree refers to, the binder a node
+    // introduces itself sits at level + 1 and does not count outside of that node
+    auto outside(size_t reach) -> size_t {
+      return reach <= this->level ? reach : unbound;
+    }
+
+    auto bind(string name) -> void {
+      this->level += 1;
+      this->binders[name].push_back(this->level);
+    }
+
+    auto unbind(string name) -> void {
+      this->level -= 1;
+      this->binders[name].pop_back();
+    }
+
+    template<typename Make>
+    auto lookup(NodeType type, string name, shared_ptr<Node> first, shared_ptr<Node> second,
+                size_t reach, Make make) -> shared_ptr<Node> {
+      auto closed = reach == unbound;
+      node_key key(type, name, first.get(), second.get(), closed);
+      auto result = this->table.find(key);
+      if (result != this->table.end()) {
+        // identifiers are cheap enough to look up again
+        if (closed && type != NodeType::IDENTIFIER) {
+          result->second->memoize = true;
+        }
+        return result->second;
+      }
+      shared_ptr<Node> node = make();
+      this->table[key] = node;
+      return node;
+    }
+
+    auto intern(shared_ptr<Node> node, size_t &reach) -> shared_ptr<Node> {
+      this->visit();
+      switch (node->type()) {
+      case NodeType::IDENTIFIER: {
+        auto name = static_pointer_cast<Identifier>(node)->name;
+        auto scope = this->binders.find(name);
+        reach = scope == this->binders.end() || scope->second.empty() ? unbound : scope->second.back();
+        return lookup(NodeType::IDENTIFIER, name, nullptr, nullptr, reach, [&]() {
+            return make_shared<Identifier>(name);
+          });
+      }
+      case NodeType::APPLY: {
+        auto apply_node = static_pointer_cast<Apply>(node);
+        size_t func_reach, arg_reach;
+        auto func = intern(apply_node->func, func_reach);
+        auto arg = intern(apply_node->arg, arg_reach);
+        reach = std::min(func_reach, arg_reach);
+        return lookup(NodeType::APPLY, "", func, arg, reach, [&]() {
+            return make_shared<Apply>(func, arg);
+          });
+      }
+      case NodeType::LAMBDA: {
+        auto lambda_node = static_pointer_cast<Lambda>(node);
+        auto param = lambda_node->param;
+        size_t body_reach;
+        bind(param);
+        auto body = intern(lambda_node->body, body_reach);
+        unbind(param);
+        reach = outside(body_reach);
+        return lookup(NodeType::LAMBDA, param, body, nullptr, reach, [&]() {
+            return make_shared<Lambda>(param, body);
+          });
+      }
+      case NodeType::LET: {
+        auto let_node = static_pointer_cast<Let>(node);
+        auto name = let_node->name;
+        size_t defn_reach, body_reach;
+        auto defn = intern(let_node->defn, defn_reach);
+        bind(name);
+        auto body = intern(let_node->body, body_reach);
+        unbind(name);
+        reach = std::min(defn_reach, outside(body_reach));
+        return lookup(NodeType::LET, name, defn, body, reach, [&]() {
+            return make_shared<Let>(name, defn, body);
+          });
+      }
+      case NodeType::LETREC: {
+        auto letrec_node = static_pointer_cast<Letrec>(node);
+        auto name = letrec_node->name;
+        size_t defn_reach, body_reach;
+        bind(name);
+        auto defn = intern(letrec_node->defn, defn_reach);
+        auto body = intern(letrec_node->body, body_reach);
+        unbind(name);
+        reach = outside(std::min(defn_reach, body_reach));
+        return lookup(NodeType::LETREC, name, defn, body, reach, [&]() {
+            return make_shared<Letrec>(name, defn, body);
+          });
+      }
+      default:
+        reach = unbound;
+        return node;
+      }
+    }
+  };
+}
@@ -1,18 +1,21 @@
 #include <string>
+#include <fstream>
 #include <iostream>
 #include "type.hpp"
+#include "stream.hpp"
 #include "checker.hpp"
 
 using namespace std;
 using namespace ast;
 using namespace type;
+using namespace stream;
 using namespace checker;
 
 auto try_analyse(shared_ptr<Node> expr, environment env) -> shared_ptr<Type> {
   try {
     return analyse(expr, env);
   } catch (std::runtime_error &e) {
-    cout << expr->to_string() << " runtime error: " << e.what () << endl;
+    cout << expr->to_string() << " runtime error: " << e.what () << '\n';
     return nullptr;
   }
 }
@@ -21,24 +24,64 @@ auto get_type(shared_ptr<Node> expr, environment env) -> void {
   auto type = try_analyse(expr, env);
   if (type != nullptr) {
     cout << expr->to_string() << " type: " << type->to_string();
-    cout << " normalize: " << normalize(type)->to_string() << endl;
+    cout << " normalize: " << normalize(type)->to_string() << '\n';
   }
 }
 
+auto usage() -> int {
+  cerr << "usage: main [--max-type-size N] [--max-unify-steps N] [--max-type-memory BYTES] [--timeout MS] [FILE | -]\n";
+  return 2;
+}
+
 int main(int argc, char** argv) {
-  auto var1 = make_shared<TypeVariable>();
-  auto var2 = make_shared<TypeVariable>();
-  auto var3 = make_shared<TypeVariable>();
-
-  auto pair_type = make_shared<TypeOperator>("*", vector<shared_ptr<Type>>({ var1, var2 }));
-  environment env = {
-    { "true", BooleanType },
-    { "pair", FunctionType(var1, FunctionType(var2, pair_type)) },
-    { "cond", FunctionType(BooleanType, FunctionType(var3, FunctionType(var3, var3))) },
-    { "pred", FunctionType(IntegerType, IntegerType) },
-    { "zero?", FunctionType(IntegerType, BooleanType) },
-    { "times", FunctionType(IntegerType, FunctionType(IntegerType, IntegerType)) }
-  };
+  ios::sync_with_stdio(false);
+
+  Limits limits;
+  string input = "";
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.compare(0, 2, "--") == 0) {
+      if (i + 1 >= argc) {
+        return usage();
+      }
+      size_t value;
+      try {
+        value = stoul(argv[++i]);
+      } catch (std::logic_error &e) {
+        return usage();
+      }
+      if (arg == "--max-type-size") {
+        limits.max_type_size = value;
+      } else if (arg == "--max-unify-steps") {
+        limits.max_unify_steps = value;
+      } else if (arg == "--max-type-memory") {
+        limits.max_type_memory = value;
+      } else if (arg == "--timeout") {
+        limits.timeout = chrono::milliseconds(value);
+      } else {
+        return usage();
+      }
+    } else if (input.empty()) {
+      input = arg;
+    } else {
+      return usage();
+    }
+  }
+
+  auto env = default_env();
+
+  if (input == "-") {
+    check_stream(cin, cout, env, limits);
+    return 0;
+  } else if (!input.empty()) {
+    ifstream file(input);
+    if (!file) {
+      cerr << "can not open " << input << '\n';
+      return 1;
+    }
+    check_stream(file, cout, env, limits);
+    return 0;
+  }
 
   auto pair = make_shared<Apply>(make_shared<Apply>(make_shared<Identifier>("pair"), make_shared<Apply>(make_shared<Identifier>("f"), make_shared<Identifier>("3"))),
                                  make_shared<Apply>(make_shared<Identifier>("f"), make_shared<Identifier>("true")));
@@ -99,6 +142,7 @@ int main(int argc, char** argv) {
   get_type(infinite_expr, env);
   get_type(lazy_expr, env);
   get_type(compose_expr, env);
+  cout.flush();
 
   return 0;
 }
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cctype>
+#include <istream>
+#include <stdexcept>
+#ifndef FORMAT_HEADER
+#define FORMAT_HEADER
+#include <fmt/format.h>
+#include <fmt/format.cc>
+#endif
+#include "ast.hpp"
+
+using namespace std;
+using namespace ast;
+using namespace fmt;
+
+namespace parser {
+  // expr ::= (λ|\) id . expr
+  //        | let id = expr in expr
+  //        | letrec id = expr in expr
+  //        | atom atom*
+  // atom ::= id | ( expr )
+  // top level expressions are separated by ';', '#' starts a comment
+  enum class TokenType : size_t {
+    LPAREN,
+    RPAREN,
+    LAMBDA,
+    DOT,
+    EQUALS,
+    SEMICOLON,
+    LET,
+    LETREC,
+    IN,
+    IDENTIFIER,
+    END
+  };
+
+  struct Token {
+    TokenType type;
+    string text;
+  };
+
+  class ParseError : public runtime_error {
+  public:
+    ParseError(string msg): runtime_error(msg) {};
+  };
+
+  // every later pass walks the ast recursively, so deeper input would overflow their stack
+  const size_t default_max_depth = 1000;
+
+  // adds to the depth of the expression being parsed and gives it back when it goes out of scope
+  class Nesting {
+  public:
+    Nesting(size_t &depth, size_t max_depth)
+      : depth(depth), max_depth(max_depth), amount(0) {
+      deeper();
+    };
+
+    ~Nesting() {
+      this->depth -= this->amount;
+    }
+
+    auto deeper() -> void {
+      if (this->depth >= this->max_depth) {
+        throw ParseError(format("Expression nested deeper than {}", this->max_depth));
+      }
+      this->depth += 1;
+      this->amount += 1;
+    }
+
+  private:
+    size_t &depth;
+    size_t max_depth;
+    size_t amount;
+  };
+
+  // pulls characters from the stream on demand, so only one token is ever held in memory
+  class Lexer {
+  public:
+    Lexer(istream &in): in(in) {};
+
+    auto next() -> Token {
+      skip_blank();
+      auto c = this->in.get();
+      switch (c) {
+      case EOF:
+        return { TokenType::END, "" };
+      case '(':
+        return { TokenType::LPAREN, "(" };
+      case ')':
+        return { TokenType::RPAREN, ")" };
+      case '\\':
+        return { TokenType::LAMBDA, "λ" };
+      case '.':
+        return { TokenType::DOT, "." };
+      case '=':
+        return { TokenType::EQUALS, "=" };
+      case ';':
+        return { TokenType::SEMICOLON, ";" };
+      default:
+        break;
+      }
+      // λ is 0xCE 0xBB in UTF-8
+      if (c == 0xCE && this->in.peek() == 0xBB) {
+        this->in.get();
+        return { TokenType::LAMBDA, "λ" };
+      }
+      string name(1, (char)c);
+      while (is_name_char(this->in.peek())) {
+        name.push_back((char)this->in.get());
+      }
+      if (name == "let") {
+        return { TokenType::LET, name };
+      } else if (name == "letrec") {
+        return { TokenType::LETREC, name };
+      } else if (name == "in") {
+        return { TokenType::IN, name };
+      } else {
+        return { TokenType::IDENTIFIER, name };
+      }
+    }
+
+  private:
+    istream &in;
+
+    static auto is_name_char(int c) -> bool {
+      return c != EOF && c != 0xCE && !isspace(c) && string("()\\.=;#").find((char)c) == string::npos;
+    }
+
+    auto skip_blank() -> void {
+      while (true) {
+        auto c = this->in.peek();
+        if (c == '#') {
+          while (c != EOF && c != '\n') {
+            this->in.get();
+            c = this->in.peek();
+          }
+        } else if (c != EOF && isspace(c)) {
+          this->in.get();
+        } else {
+          return;
+        }
+      }
+    }
+  };
+
+  class Parser {
+  public:
+    Parser(istream &in, size_t max_depth = default_max_depth)
+      : lexer(in), depth(0), max_depth(max_depth) {
+      this->current = this->lexer.next();
+    };
+
+    // the next top level expression, nullptr once the input is exhausted
+    auto next() -> shared_ptr<Node> {
+      while (this->current.type == TokenType::SEMICOLON) {
+        advance();
+      }
+      if (this->current.type == TokenType::END) {
+        return nullptr;
+      }
+      auto expr = parse_expr();
+      if (this->current.type != TokenType::END) {
+        expect(TokenType::SEMICOLON, "';'");
+      }
+      return expr;
+    }
+
+    // skip the rest of a malformed expression so parsing can resume at the next one
+    auto recover() -> void {
+      while (this->current.type != TokenType::SEMICOLON && this->current.type != TokenType::END) {
+        advance();
+      }
+    }
+
+  private:
+    Lexer lexer;
+    Token current;
+    size_t depth;
+    size_t max_depth;
+
+    auto advance() -> Token {
+      auto token = this->current;
+      this->current = this->lexer.next();
+      return token;
+    }
+
+    auto expect(TokenType type, string what) -> Token {
+      if (this->current.type != type) {
+        auto found = this->current.type == TokenType::END ? "end of input" : format("'{}'", this->current.text);
+        throw ParseError(format("Expected {0} but found {1}", what, found));
+      }
+      return advance();
+    }
+
+    auto parse_binding(bool recursive) -> shared_ptr<Node> {
+      auto name = expect(TokenType::IDENTIFIER, "identifier").text;
+      expect(TokenType::EQUALS, "'='");
+      auto defn = parse_expr();
+      expect(TokenType::IN, "'in'");
+      auto body = parse_expr();
+      if (recursive) {
+        return make_shared<Letrec>(name, defn, body);
+      } else {
+        return make_shared<Let>(name, defn, body);
+      }
+    }
+
+    auto parse_expr() -> shared_ptr<Node> {
+      Nesting nesting(this->depth, this->max_depth);
+      switch (this->current.type) {
+      case TokenType::LAMBDA: {
+        advance();
+        auto param = expect(TokenType::IDENTIFIER, "identifier").text;
+        expect(TokenType::DOT, "'.'");
+        return make_shared<Lambda>(param, parse_expr());
+      }
+      case TokenType::LET:
+        advance();
+        return parse_binding(false);
+      case TokenType::LETREC:
+        advance();
+        return parse_binding(true);
+      default:
+        return parse_apply();
+      }
+    }
+
+    auto parse_apply() -> shared_ptr<Node> {
+      auto func = parse_atom();
+      // every argument puts the function one level deeper in the ast
+      Nesting nesting(this->depth, this->max_depth);
+      while (true) {
+        switch (this->current.type) {
+        case TokenType::IDENTIFIER:
+        case TokenType::LPAREN:
+          nesting.deeper();
+          func = make_shared<Apply>(func, parse_atom());
+          break;
+        case TokenType::LAMBDA:
+        case TokenType::LET:
+        case TokenType::LETREC:
+          // a trailing binder extends as far right as possible
+          nesting.deeper();
+          return make_shared<Apply>(func, parse_expr());
+        default:
+          return func;
+        }
+      }
+    }
+
+    auto parse_atom() -> shared_ptr<Node> {
+      if (this->current.type == TokenType::LPAREN) {
+        advance();
+        auto expr = parse_expr();
+        expect(TokenType::RPAREN, "')'");
+        return expr;
+      }
+      return make_shared<Identifier>(expect(TokenType::IDENTIFIER, "expression").text);
+    }
+  };
+}
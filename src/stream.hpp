@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <istream>
+#include <ostream>
+#include "type.hpp"
+#include "parser.hpp"
+#include "channel.hpp"
+#include "checker.hpp"
+
+using namespace std;
+using namespace ast;
+using namespace type;
+using namespace parser;
+using namespace channel;
+using namespace checker;
+
+namespace stream {
+  // how many expressions may sit between two pipeline stages
+  const size_t pipeline_depth = 64;
+
+  // how long the printer waits for a result before it lets buffered lines out
+  const chrono::milliseconds flush_after(50);
+
+  struct Parsed {
+    shared_ptr<Node> expr;
+    string error;
+  };
+
+  struct Checked {
+    shared_ptr<Node> expr;
+    CheckResult result;
+  };
+
+  // parse, check and print run as three threads joined by bounded queues,
+  // each expression is dropped by the printer right after its line is written
+  auto check_stream(istream &in, ostream &out, environment env, Limits limits) -> void {
+    BoundedQueue<Parsed> parsed(pipeline_depth);
+    BoundedQueue<Checked> checked(pipeline_depth);
+
+    thread parse_stage([&]() {
+        Parser parser(in);
+        while (true) {
+          try {
+            auto expr = parser.next();
+            if (expr == nullptr) {
+              break;
+            }
+            parsed.push({ expr, "" });
+          } catch (ParseError &e) {
+            parsed.push({ nullptr, e.what() });
+            parser.recover();
+          }
+        }
+        parsed.close();
+      });
+
+    thread check_stage([&]() {
+        Parsed item;
+        while (parsed.pop(item)) {
+          if (item.expr == nullptr) {
+            checked.push({ nullptr, { CheckStatus::PARSE_ERROR, nullptr, Resource::NONE, item.error } });
+          } else {
+            checked.push({ item.expr, check(item.expr, env, limits) });
+          }
+          item = Parsed();
+        }
+        checked.close();
+      });
+
+    Checked item;
+    while (true) {
+      if (!checked.pop_for(item, flush_after)) {
+        // the checker is stalled or waiting on input, let the lines written so far out
+        out.flush();
+        if (!checked.pop(item)) {
+          break;
+        }
+      }
+      auto &result = item.result;
+      switch (result.status) {
+      case CheckStatus::PARSE_ERROR:
+        out << "parse error: " << result.message << '\n';
+        break;
+      case CheckStatus::OK:
+        out << item.expr->to_string() << " type: " << result.type->to_string();
+        out << " normalize: " << normalize(result.type)->to_string() << '\n';
+        break;
+      case CheckStatus::BUDGET_EXCEEDED:
+        out << item.expr->to_string() << " budget exceeded: " << resource_name(result.resource) << '\n';
+        break;
+      default:
+        out << item.expr->to_string() << " runtime error: " << result.message << '\n';
+        break;
+      }
+      item = Checked();
+    }
+
+    parse_stage.join();
+    check_stage.join();
+    out.flush();
+  }
+}
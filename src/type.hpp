@@ -1,5 +1,6 @@
 #pragma once
 
+#include <set>
 #include <string>
 #include <vector>
 #include <memory>
@@ -33,7 +34,8 @@ namespace type {
     int id;
     shared_ptr<Type> instance;
 
-    static int next_id;
+    // every thread checks on its own, so each one numbers its variables itself
+    static thread_local int next_id;
 
     TypeVariable() {
       if (TypeVariable::next_id == 25) {
@@ -65,7 +67,7 @@ namespace type {
     }
   };
 
-  int TypeVariable::next_id = 0;
+  thread_local int TypeVariable::next_id = 0;
 
   class TypeOperator : public Type {
   public:
@@ -151,27 +153,27 @@ namespace type {
     }
   }
 
-  auto minus_base(shared_ptr<Type> t, int base) -> shared_ptr<Type> {
+  // a variable can occur many times in t, shifted keeps it from being moved more than once
+  auto minus_base(shared_ptr<Type> t, int base, set<Type*> &shifted) -> shared_ptr<Type> {
     switch (t->type()) {
     case TypeType::VARIABLE: {
       auto var = static_pointer_cast<TypeVariable>(t);
       if (var->instance == nullptr) {
-        if (var->id >= base) {
+        if (var->id >= base && shifted.insert(var.get()).second) {
           var->id -= base;
         }
       } else {
-        auto new_instance = minus_base(var->instance, base);
+        auto new_instance = minus_base(var->instance, base, shifted);
         var->instance = new_instance;
       }
       return var;
     }
     case TypeType::OPERATOR: {
+      // rewrite in place, constants like IntegerType are shared and must not be written to
       auto oper = static_pointer_cast<TypeOperator>(t);
-      auto new_types = oper->types
-        | view::transform([=](shared_ptr<Type> tt) {
-            return minus_base(tt, base);
-          });
-          oper->types = new_types;
+      for (auto &tt : oper->types) {
+        tt = minus_base(tt, base, shifted);
+      }
       return oper;
     }
     default:
@@ -184,7 +186,8 @@ namespace type {
     auto min_iter = std::min_element(ids.cbegin(), ids.cend());
     if (min_iter != ids.end()) {
       auto min_id = *min_iter;
-      return minus_base(t, min_id);
+      set<Type*> shifted = {};
+      return minus_base(t, min_id, shifted);
     } else {
       return t;
     }
@@ -2,13 +2,25 @@
 #include "catch.hpp"
 #include "../src/ast.hpp"
 #include "../src/type.hpp"
+#include "../src/parser.hpp"
+#include "../src/interner.hpp"
+#include "../src/channel.hpp"
 #include "../src/checker.hpp"
+#include "../src/stream.hpp"
 #include <vector>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 using namespace std;
 using namespace ast;
 using namespace type;
+using namespace parser;
+using namespace interner;
+using namespace channel;
 using namespace checker;
+using namespace stream;
 
 TEST_CASE("basic type inference") {
   struct GoodTestCase {
@@ -121,3 +133,318 @@ TEST_CASE("basic type inference") {
       REQUIRE(msg == c.error_msg);
     });
 }
+
+TEST_CASE("resource budgets") {
+  auto env = default_env();
+
+  // let f0 = λx. pair x x in let f1 = λx. f0 (f0 x) in ... fn, every level squares the size of the type
+  shared_ptr<Node> expr = make_shared<Identifier>("f5");
+  for (int i = 5; i > 0; i--) {
+    auto prev = make_shared<Identifier>(format("f{}", i - 1));
+    expr = make_shared<Let>(format("f{}", i),
+                            make_shared<Lambda>("x", make_shared<Apply>(prev, make_shared<Apply>(prev, make_shared<Identifier>("x")))),
+                            expr);
+  }
+  expr = make_shared<Let>("f0",
+                          make_shared<Lambda>("x", make_shared<Apply>(make_shared<Apply>(make_shared<Identifier>("pair"),
+                                                                                         make_shared<Identifier>("x")),
+                                                                      make_shared<Identifier>("x"))),
+                          expr);
+
+  auto run = [&](Limits limits) -> CheckResult {
+    return check(expr, env, limits);
+  };
+
+  Limits type_size_limits;
+  type_size_limits.max_type_size = 1000;
+  auto result = run(type_size_limits);
+  REQUIRE(result.status == CheckStatus::BUDGET_EXCEEDED);
+  REQUIRE(result.resource == Resource::TYPE_SIZE);
+  REQUIRE(result.message == "Budget exceeded: type size");
+
+  Limits unify_limits;
+  unify_limits.max_unify_steps = 1000;
+  result = run(unify_limits);
+  REQUIRE(result.status == CheckStatus::BUDGET_EXCEEDED);
+  REQUIRE(result.resource == Resource::UNIFY_STEPS);
+
+  Limits memory_limits;
+  memory_limits.max_type_memory = 64 * 1024;
+  result = run(memory_limits);
+  REQUIRE(result.status == CheckStatus::BUDGET_EXCEEDED);
+  REQUIRE(result.resource == Resource::TYPE_MEMORY);
+
+  Limits deadline_limits;
+  deadline_limits.timeout = chrono::milliseconds(1);
+  result = run(deadline_limits);
+  REQUIRE(result.status == CheckStatus::BUDGET_EXCEEDED);
+  REQUIRE(result.resource == Resource::DEADLINE);
+
+  auto small = make_shared<Apply>(make_shared<Identifier>("f0"), make_shared<Identifier>("3"));
+  auto small_expr = make_shared<Let>("f0", static_pointer_cast<Let>(expr)->defn, small);
+  auto ok = check(small_expr, env, type_size_limits);
+  REQUIRE(ok.status == CheckStatus::OK);
+  REQUIRE(ok.resource == Resource::NONE);
+  REQUIRE(normalize(ok.type)->to_string() == "(int * int)");
+
+  auto bad = check(make_shared<Identifier>("nope"), env, type_size_limits);
+  REQUIRE(bad.status == CheckStatus::TYPE_ERROR);
+  REQUIRE(bad.resource == Resource::NONE);
+  REQUIRE(bad.message == "Undefined symbol nope");
+}
+
+TEST_CASE("parse expression stream") {
+  istringstream in(
+    "# factorial\n"
+    "letrec factorial = λn. cond (zero? n) 1 (times n (factorial (pred n))) in factorial 5;\n"
+    "let f = \\x. x in pair (f 3) (f true);\n"
+    "(λf. f f);\n"
+    "let = 3;\n"
+    "f (g x) \\y. y");
+
+  Parser parser(in);
+  REQUIRE(parser.next()->to_string() == "(letrec factorial = (λn. (((cond (zero? n)) 1) ((times n) (factorial (pred n))))) in (factorial 5))");
+  REQUIRE(parser.next()->to_string() == "(let f = (λx. x) in ((pair (f 3)) (f true)))");
+  REQUIRE(parser.next()->to_string() == "(λf. (f f))");
+
+  string error_msg = "";
+  try {
+    parser.next();
+  } catch (ParseError &e) {
+    error_msg = e.what();
+    parser.recover();
+  }
+  REQUIRE(error_msg == "Expected identifier but found '='");
+
+  REQUIRE(parser.next()->to_string() == "((f (g x)) (λy. y))");
+  REQUIRE(parser.next() == nullptr);
+}
+
+TEST_CASE("concurrent checks") {
+  auto env = default_env();
+
+  // the two threads run under different limits at the same time, neither may see the other's
+  atomic<int> failures(0);
+  auto run = [&](string source, Limits limits, CheckStatus status) {
+      for (int i = 0; i < 500; i++) {
+        istringstream in(source);
+        auto result = check(Parser(in).next(), env, limits);
+        if (result.status != status) {
+          failures++;
+        }
+      }
+    };
+
+  Limits tight;
+  tight.max_unify_steps = 5;
+  thread limited(run, "λa. λb. λc. pair (pair a b) (pair c a)", tight, CheckStatus::BUDGET_EXCEEDED);
+  thread unlimited(run, "λa. λb. λc. pair (pair a b) (pair c a)", Limits(), CheckStatus::OK);
+  limited.join();
+  unlimited.join();
+  REQUIRE(failures == 0);
+}
+
+TEST_CASE("hash consing with memoized inference") {
+  auto env = default_env();
+
+  auto compose = [] {
+    istringstream in("λf. λg. λarg. f (g arg)");
+    return Parser(in).next();
+  };
+
+  // the same combinator inlined at two sites, and once more under a binder it does not capture
+  istringstream in(
+    "pair ((" + compose()->to_string() + ") pred pred 3)"
+    " ((λf. (" + compose()->to_string() + ") f (λx. x) true) (λb. b))");
+  auto expr = Parser(in).next();
+
+  auto interned = Interner().intern(expr);
+  auto apply = static_pointer_cast<Apply>(interned);
+  auto first = static_pointer_cast<Apply>(static_pointer_cast<Apply>(static_pointer_cast<Apply>(static_pointer_cast<Apply>(apply->func)->arg)->func)->func)->func;
+  auto inner = static_pointer_cast<Lambda>(static_pointer_cast<Apply>(apply->arg)->func)->body;
+  auto second = static_pointer_cast<Apply>(static_pointer_cast<Apply>(static_pointer_cast<Apply>(inner)->func)->func)->func;
+
+  REQUIRE(interned->to_string() == expr->to_string());
+  REQUIRE(first.get() == second.get());
+  REQUIRE(first->memoize);
+  REQUIRE(!interned->memoize);
+
+  auto expected = normalize(analyse(expr, env))->to_string();
+  REQUIRE(expected == "(int * bool)");
+  REQUIRE(normalize(analyse(interned, env))->to_string() == expected);
+
+  auto result = check(expr, env, Limits());
+  REQUIRE(result.status == CheckStatus::OK);
+  REQUIRE(normalize(result.type)->to_string() == expected);
+
+  // ten copies of a combinator, and the same ten copies with their parameters renamed
+  // apart so that none of them is shared, without the memo both take the same steps
+  auto combinator = [](string suffix) -> string {
+    return format("(λf{0}. λg{0}. λh{0}. λk{0}. λarg{0}. f{0} (g{0} (h{0} (k{0} arg{0}))))", suffix);
+  };
+  string same = "3";
+  string renamed = "3";
+  for (int i = 0; i < 10; i++) {
+    same = format("pair ({} pred pred pred pred 3) ({})", combinator(""), same);
+    renamed = format("pair ({} pred pred pred pred 3) ({})", combinator(format("{}", i)), renamed);
+  }
+  istringstream same_in(same);
+  istringstream renamed_in(renamed);
+  auto same_result = check(Parser(same_in).next(), env, Limits());
+  auto renamed_result = check(Parser(renamed_in).next(), env, Limits());
+  REQUIRE(same_result.status == CheckStatus::OK);
+  REQUIRE(renamed_result.status == CheckStatus::OK);
+  REQUIRE(normalize(same_result.type)->to_string() == normalize(renamed_result.type)->to_string());
+  // only the first copy is inferred, the other nine are instantiated from the memo
+  REQUIRE(same_result.unify_steps * 2 < renamed_result.unify_steps);
+
+  // a failing check must not leave its memoized types behind
+  auto failing = format("pair ({0} pred pred 3) ({0} pred pred true)", combinator(""));
+  istringstream failing_in(failing);
+  auto failed = check(Parser(failing_in).next(), env, Limits());
+  REQUIRE(failed.status == CheckStatus::TYPE_ERROR);
+  REQUIRE(memo.empty());
+
+  // x is bound by the enclosing lambda, so the two copies of (pred x) are not closed
+  istringstream open_in("λx. pair (pred x) (pred x)");
+  auto open_expr = Interner().intern(Parser(open_in).next());
+  auto body = static_pointer_cast<Apply>(static_pointer_cast<Lambda>(open_expr)->body);
+  REQUIRE(body->arg.get() == static_pointer_cast<Apply>(body->func)->arg.get());
+  REQUIRE(!body->arg->memoize);
+
+  // (λx. pair x y) binds its own x but still refers to the y outside of it
+  size_t visited = 0;
+  istringstream outer_in("λy. pair (λx. pair x y) (λx. pair x y)");
+  auto outer_expr = Interner([&]() { visited++; }).intern(Parser(outer_in).next());
+  auto outer_body = static_pointer_cast<Apply>(static_pointer_cast<Lambda>(outer_expr)->body);
+  REQUIRE(outer_body->arg.get() == static_pointer_cast<Apply>(outer_body->func)->arg.get());
+  REQUIRE(!outer_body->arg->memoize);
+  REQUIRE(visited == 16);
+}
+
+TEST_CASE("bounded queue") {
+  BoundedQueue<int> queue(2);
+  queue.push(1);
+  queue.push(2);
+
+  atomic<bool> pushed(false);
+  thread producer([&]() {
+      queue.push(3);
+      pushed = true;
+    });
+
+  // the queue is full, so the producer has to wait for a pop
+  this_thread::sleep_for(chrono::milliseconds(50));
+  REQUIRE(!pushed);
+
+  int item = 0;
+  REQUIRE(queue.pop(item));
+  REQUIRE(item == 1);
+  producer.join();
+  REQUIRE(pushed);
+
+  REQUIRE(queue.pop_for(item, chrono::milliseconds(0)));
+  REQUIRE(item == 2);
+  queue.push(2);
+
+  // whatever was pushed before close is still drained in order
+  queue.close();
+  REQUIRE(queue.pop(item));
+  REQUIRE(item == 3);
+  REQUIRE(queue.pop(item));
+  REQUIRE(item == 2);
+  REQUIRE(!queue.pop(item));
+  REQUIRE(!queue.pop_for(item, chrono::milliseconds(10)));
+
+  BoundedQueue<int> idle(1);
+  REQUIRE(!idle.pop_for(item, chrono::milliseconds(10)));
+  REQUIRE(!queue.pop(item));
+}
+
+TEST_CASE("check expression stream") {
+  auto env = default_env();
+
+  // neither of these may take the rest of the stream down with a stack overflow
+  string chain = "f";
+  for (int i = 0; i < 5000; i++) {
+    chain += format(" a{}", i);
+  }
+
+  istringstream in(
+    "pair 1 true;\n" +
+    string(100000, '(') + ";\n" +
+    chain + ";\n"
+    "let = 3;\n"
+    "pair (λx. x x) 1;\n"
+    "let f0 = λx. pair x x in let f1 = λx. f0 (f0 x) in let f2 = λx. f1 (f1 x) in let f3 = λx. f2 (f2 x) in f3;\n"
+    "nope;\n"
+    "pair true 1");
+  ostringstream out;
+  Limits limits;
+  limits.max_type_size = 100;
+  check_stream(in, out, env, limits);
+
+  REQUIRE(out.str() ==
+          "((pair 1) true) type: (int * bool) normalize: (int * bool)\n"
+          "parse error: Expression nested deeper than 1000\n"
+          "parse error: Expression nested deeper than 1000\n"
+          "parse error: Expected identifier but found '='\n"
+          "((pair (λx. (x x))) 1) runtime error: Recursive unification\n"
+          "(let f0 = (λx. ((pair x) x)) in (let f1 = (λx. (f0 (f0 x))) in (let f2 = (λx. (f1 (f1 x))) in (let f3 = (λx. (f2 (f2 x))) in f3)))) budget exceeded: type size\n"
+          "nope runtime error: Undefined symbol nope\n"
+          "((pair true) 1) type: (bool * int) normalize: (bool * int)\n");
+}
+
+TEST_CASE("stream output is not flushed per line") {
+  // counts how often the stream is asked to flush
+  class CountingBuffer : public stringbuf {
+  public:
+    size_t syncs = 0;
+
+  protected:
+    int sync() {
+      this->syncs += 1;
+      return stringbuf::sync();
+    }
+  };
+
+  auto env = default_env();
+
+  string input = "";
+  for (int i = 0; i < 5000; i++) {
+    input += "λx. pair x 3;\n";
+  }
+  istringstream in(input);
+  CountingBuffer buffer;
+  ostream out(&buffer);
+  check_stream(in, out, env, Limits());
+
+  auto written = buffer.str();
+  REQUIRE(count(written.begin(), written.end(), '\n') == 5000);
+  // once at the end, plus whenever the printer sat idle for flush_after
+  REQUIRE(buffer.syncs < 10);
+}
+
+TEST_CASE("stream results do not depend on earlier expressions") {
+  auto env = default_env();
+
+  // the let allocates more than 25 variables, so ids wrap around before x and the fresh
+  // variables of pair are created and some of them share an id with k's
+  string junk = "let k = λa. λb. λc. λd. pair (pair (pair a b) (pair c d)) (pair (pair b a) (pair d c)) in ";
+  string printed_junk = "(let k = (λa. (λb. (λc. (λd. ((pair ((pair ((pair a) b)) ((pair c) d))) ((pair ((pair b) a)) ((pair d) c))))))) in ";
+  string input = "";
+  string expected = "";
+  for (int i = 0; i < 30; i++) {
+    input += junk + "λx. pair x 3; λf. λg. λarg. f (g arg); " + junk + "λf. λg. λarg. f (g arg);\n";
+    // every check restarts the variable ids, so even the raw types repeat exactly
+    expected +=
+      printed_junk + "(λx. ((pair x) 3))) type: (i -> (i * int)) normalize: (a -> (a * int))\n"
+      "(λf. (λg. (λarg. (f (g arg))))) type: ((d -> e) -> ((c -> d) -> (c -> e))) normalize: ((b -> c) -> ((a -> b) -> (a -> c)))\n" +
+      printed_junk + "(λf. (λg. (λarg. (f (g arg)))))) type: ((k -> l) -> ((j -> k) -> (j -> l))) normalize: ((b -> c) -> ((a -> b) -> (a -> c)))\n";
+  }
+
+  istringstream in(input);
+  ostringstream out;
+  check_stream(in, out, env, Limits());
+  REQUIRE(out.str() == expected);
+}